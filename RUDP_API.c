@@ -3,9 +3,15 @@
  * Wasim
  * Shifaa
 */
+#define _GNU_SOURCE     // For sched_setaffinity and CPU_SET
 #include "RUDP_API.h"
+#include "RUDP_Compress.h"
+#include "RUDP_Internal.h"
+#include "RUDP_Timer.h"
 #include <arpa/inet.h>  // For functions like inet_pton
 #include <errno.h>      // For error handling
+#include <poll.h>       // For waiting on several paths at once
+#include <sched.h>      // For pinning the polling thread to a CPU
 #include <stdio.h>      // For standard I/O operations
 #include <stdlib.h>     // For dynamic memory allocation and other standard functions
 #include <string.h>     // For string manipulation functions
@@ -24,6 +30,102 @@ struct sockaddr_in client_address;
 //struct Timeout value for socket operations.
  struct timeval timeout;
 
+/*
+ * Per-socket settings, indexed by file descriptor. Sockets past the table
+ * keep the defaults and cannot be configured.
+ */
+#define RUDP_MAX_SOCKETS 1024
+
+typedef struct SocketOptions {
+    int spin_us;            // Spin budget of the low-latency mode in microseconds (0 = disabled)
+    int compress;           // Whether rudp_send runs messages through the compression stage
+    int rate_kbps;          // Emulated link rate of outgoing data in kbit/s (0 = unlimited)
+    uint64_t link_free_at;  // When the emulated link has sent everything handed to it
+    int send_bit;           // msgBit of the next message sent
+    int recv_bit;           // msgBit of the message being received
+} SocketOptions;
+
+static SocketOptions socket_options[RUDP_MAX_SOCKETS];
+
+// Time spent spinning versus sleeping in the low-latency mode, updated atomically by every thread
+static RUDP_PollStats poll_stats;
+
+// Effect and cost of the compression stage, updated atomically by every thread
+static RUDP_CompressStats compress_stats;
+
+// Multipath connections, see the multipath section below
+typedef struct Multipath Multipath;
+static Multipath *get_multipath(int socket, int create);
+static void drop_multipath(int socket);
+static int mp_send(Multipath *mp, const char *data, int size, const RUDP_Policy *policy, int compress);
+static int mp_receive(Multipath *mp, int socket, char **buffer, int *size);
+
+static SocketOptions *get_options(int socket) {
+    if (socket < 0 || socket >= RUDP_MAX_SOCKETS) {
+        return NULL;
+    }
+    return &socket_options[socket];
+}
+
+// Back to the defaults, so a descriptor number reused later starts clean
+void rudp_reset_socket(int socket) {
+    SocketOptions *options = get_options(socket);
+    if (options != NULL) {
+        __atomic_store_n(&options->spin_us, 0, __ATOMIC_RELAXED);
+        options->compress = 0;
+        options->rate_kbps = 0;
+        options->link_free_at = 0;
+        options->send_bit = 0;
+        options->recv_bit = 0;
+    }
+}
+
+static int spin_budget(int socket) {
+    SocketOptions *options = get_options(socket);
+    return options == NULL ? 0 : __atomic_load_n(&options->spin_us, __ATOMIC_RELAXED);
+}
+
+// Counters are shared by the sender and receiver threads of a process
+static void stats_add(uint64_t *counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/*
+ * Receives one packet from the socket. In low-latency mode it first spins
+ * with MSG_DONTWAIT for the configured budget and only then blocks, so a
+ * reply that arrives quickly does not pay the scheduler wakeup.
+ */
+static ssize_t recv_packet(int socket, RUDP_Packet *rudp, size_t len) {
+    int spin_us = spin_budget(socket);
+    if (spin_us <= 0) {
+        return recvfrom(socket, rudp, len, 0, NULL, 0);
+    }
+    uint64_t budget = (uint64_t)spin_us * 1000;
+    uint64_t start = now_ns();
+    uint64_t now = start;
+    ssize_t got;
+    do {
+        got = recvfrom(socket, rudp, len, MSG_DONTWAIT, NULL, 0);
+        if (got >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            stats_add(&poll_stats.spin_ns, now_ns() - start);
+            if (got >= 0) {
+                stats_add(&poll_stats.spin_hits, 1);
+            }
+            return got;
+        }
+        now = now_ns();
+    } while (now - start < budget);
+    stats_add(&poll_stats.spin_ns, now - start);
+
+    // Spin budget exhausted, block under SO_RCVTIMEO as usual
+    got = recvfrom(socket, rudp, len, 0, NULL, 0);
+    stats_add(&poll_stats.sleep_ns, now_ns() - now);
+    if (got >= 0) {
+        stats_add(&poll_stats.sleep_hits, 1);
+    }
+    return got;
+}
+
 int rudp_socket() {
     // Create a new UDP socket
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -32,13 +134,158 @@ int rudp_socket() {
         perror("Socket creation failed");
         return -1;
     }
+    rudp_reset_socket(sockfd);
     return sockfd;
 }
 
 int rudp_send(int socket, const char *data, int size) {
-    // Calculate the number of packets and size of the last packet
-    int packets = size / MAX_PACK_SIZE;
-    int last_pack_size = size % MAX_PACK_SIZE;
+    return rudp_send_ex(socket, data, size, NULL);
+}
+
+/*
+ * Emulates a link of the configured rate: a packet only leaves once the link
+ * has had the time to serialize it after everything sent before. Short waits
+ * spin, since a sleep overshoots the serialization time of fast links.
+ */
+static void pace_link(SocketOptions *options, int bytes) {
+    if (options == NULL || options->rate_kbps <= 0) {
+        return;
+    }
+    uint64_t now = now_ns();
+    uint64_t start = options->link_free_at > now ? options->link_free_at : now;
+    uint64_t done = start + (uint64_t)bytes * 8 * 1000000ULL / options->rate_kbps;
+    options->link_free_at = done;
+    if (done > now + 200000) {
+        struct timespec until = {done / 1000000000ULL, done % 1000000000ULL};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+    }
+    while (now_ns() < done) {
+    }
+}
+
+/*
+ * Waits up to a second for the ack of a data packet or, with skip set, of a
+ * forward-skip marker. A bit of -1 accepts the ack of any message.
+ */
+static int await_ack(int socket, int seq, int skip, int bit, clock_t s) {
+    RUDP_Packet *temp = (RUDP_Packet*) malloc(sizeof(RUDP_Packet));
+    if (temp == NULL) {
+        fprintf(stderr, "error allocating memory for sending ack");
+        return -1;
+    }
+    while ((double)(clock() - s) / CLOCKS_PER_SEC < 1) {
+        if (recv_packet(socket, temp, sizeof(RUDP_Packet)) == -1) {
+            free(temp);
+            return -1;
+        }
+        if (temp->sequalNum == seq && temp->flags.ack && temp->flags.isSkip == skip &&
+            (bit == -1 || temp->flags.msgBit == bit)) {
+            free(temp);
+            return 1;
+        }
+    }
+    free(temp);
+    return -1;
+}
+
+/*
+ * Replaces an abandoned segment with a forward-skip marker. The marker is
+ * retransmitted until acknowledged, otherwise the receiver keeps waiting.
+ */
+static int send_skip(int socket, int seq, int fin, int bit, SocketOptions *options) {
+    RUDP_Packet *skip = malloc(sizeof(RUDP_Packet));
+    if (skip == NULL) {
+        perror("Failed to allocate memory for skip marker");
+        return -1;
+    }
+    memset(skip, 0, sizeof(RUDP_Packet));
+    skip->flags.isSkip = 1;
+    skip->flags.fin = fin;
+    skip->flags.msgBit = bit;
+    skip->sequalNum = seq;
+    skip->checksum = calculate_checksum(skip);
+    do {
+        pace_link(options, sizeof(RUDP_Packet));
+        if (sendto(socket, skip, sizeof(RUDP_Packet), 0, NULL, 0) == -1) {
+            perror("can't send the skip marker");
+            free(skip);
+            return -1;
+        }
+    } while (await_ack(socket, seq, 1, bit, clock()) <= 0);
+    free(skip);
+    return 1;
+}
+
+int rudp_build_segment(RUDP_Packet *rudp, int seq, const char *data, int remaining, int compress) {
+    int raw = remaining < MAX_PACK_SIZE ? remaining : MAX_PACK_SIZE;
+    int consumed = raw;
+    memset(rudp, 0, RUDP_HEADER_SIZE);
+    rudp->sequalNum = seq;
+    rudp->flags.isData = 1;
+
+    // A compressed segment holds the raw length followed by an LZ block, used when it beats raw
+    if (compress) {
+        uint64_t start = now_ns();
+        int span = remaining < RUDP_MAX_SPAN ? remaining : RUDP_MAX_SPAN;
+        int length = rudp_lz_compress(data, span, rudp->data + sizeof(uint32_t),
+                                      MAX_PACK_SIZE - sizeof(uint32_t), &consumed);
+        stats_add(&compress_stats.compress_ns, now_ns() - start);
+        length += sizeof(uint32_t);
+        if (consumed > raw || (consumed == raw && length < raw)) {
+            uint32_t raw_len = htonl(consumed);
+            memcpy(rudp->data, &raw_len, sizeof(raw_len));
+            rudp->flags.isCompressed = 1;
+            rudp->length = length;
+        } else {
+            consumed = raw;
+        }
+    }
+    if (!rudp->flags.isCompressed) {
+        memcpy(rudp->data, data, raw);
+        rudp->length = raw;
+    }
+    if (compress) {
+        stats_add(&compress_stats.raw_bytes, consumed);
+        stats_add(&compress_stats.wire_bytes, rudp->length);
+    }
+    rudp->flags.fin = consumed == remaining;
+    rudp->checksum = calculate_checksum(rudp);
+    return consumed;
+}
+
+int rudp_send_ex(int socket, const char *data, int size, const RUDP_Policy *policy) {
+    int mode = policy == NULL ? RUDP_RELIABLE : policy->mode;
+    int abandoned = 0;
+    SocketOptions *options = get_options(socket);
+
+    // Sample the message once, random looking data is not worth compressing
+    int compress = options != NULL && options->compress && size > 0;
+    if (compress) {
+        uint64_t start = now_ns();
+        if (rudp_sample_entropy(data, size) > RUDP_ENTROPY_BYPASS) {
+            compress = 0;
+            stats_add(&compress_stats.bypassed, 1);
+        }
+        stats_add(&compress_stats.compress_ns, now_ns() - start);
+    }
+
+    // Connections with extra paths stripe the segments across them
+    Multipath *mp = get_multipath(socket, 0);
+    if (mp != NULL) {
+        return mp_send(mp, data, size, policy, compress);
+    }
+
+    // A deadline also bounds each ack wait, so keep the configured timeout to restore it
+    uint64_t deadline = 0;
+    struct timeval saved_timeout;
+    socklen_t timeout_len = sizeof(saved_timeout);
+    if (mode == RUDP_DEADLINE) {
+        deadline = now_ns() + (uint64_t)policy->deadline_ms * 1000000ULL;
+        if (getsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &saved_timeout, &timeout_len) < 0) {
+            perror("Error reading timeout");
+            return -1;
+        }
+    }
 
     // Allocate memory for the RUDP packet
     RUDP_Packet *rudp = malloc(sizeof(RUDP_Packet));
@@ -47,58 +294,677 @@ int rudp_send(int socket, const char *data, int size) {
         return -1;
     }
 
-    // Loop through each packet
-    for (int i = 0; i < packets; i++) {
-        memset(rudp, 0, sizeof(RUDP_Packet));
-        rudp->sequalNum = i;
-        rudp->flags.isData = 1;
-        if (i == packets - 1 && last_pack_size == 0) {
-            rudp->flags.fin = 1;
-        }
-        memcpy(rudp->data, data + i * MAX_PACK_SIZE, MAX_PACK_SIZE);
-        rudp->length = MAX_PACK_SIZE;
-        rudp->checksum = calculate_checksum(rudp);
-        
-        // Send the packet and wait for acknowledgment
-        do {
-            int send_data = sendto(socket, rudp, sizeof(RUDP_Packet), 0, NULL, 0);
-            if (send_data == -1) {
-                perror("can't send the data");
-                free(rudp);
-                return -1;
+    // Every message flips the bit, so the receiver can tell it from late copies of the previous one
+    int bit = options == NULL ? 0 : options->send_bit;
+
+    // Loop through each packet, the one reaching the end of the data carries the fin flag
+    for (int i = 0, offset = 0; offset < size; i++) {
+        offset += rudp_build_segment(rudp, i, data + offset, size - offset, compress);
+        rudp->flags.msgBit = bit;
+
+        // Send the packet and wait for acknowledgment while the policy allows it
+        int acked = 0;
+        for (int sent = 0; !acked; sent++) {
+            if (mode == RUDP_MAX_RETX && sent > policy->max_retx) {
+                break;
             }
-        } while (waiting_ack(socket, i, clock(), 1) <= 0);
-    }
-    
-    // Handle the last packet
-    if (last_pack_size > 0) {
-        memset(rudp, 0, sizeof(RUDP_Packet));
-        rudp->sequalNum = packets;
-        rudp->flags.isData = 1;
-        rudp->flags.fin = 1;
-        memcpy(rudp->data, data + (packets * MAX_PACK_SIZE), last_pack_size);
-        rudp->length = last_pack_size;
-        rudp->checksum = calculate_checksum(rudp);
-        while (waiting_ack(socket, packets, clock(), 1) <= 0) {
-            int last_pack = sendto(socket, rudp, sizeof(RUDP_Packet), 0, NULL, 0);
-            if (last_pack == -1) {
-                perror("can't send the last packet");
+            if (mode == RUDP_DEADLINE) {
+                uint64_t now = now_ns();
+                if (now >= deadline) {
+                    break;
+                }
+                uint64_t left_us = (deadline - now) / 1000 + 1;
+                timeout.tv_sec = left_us / 1000000;
+                timeout.tv_usec = left_us % 1000000;
+                if (timercmp(&timeout, &saved_timeout, >) && timerisset(&saved_timeout)) {
+                    timeout = saved_timeout;
+                }
+                if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+                    perror("Error setting timeout");
+                    free(rudp);
+                    return -1;
+                }
+            }
+            pace_link(options, RUDP_HEADER_SIZE + rudp->length);
+            if (sendto(socket, rudp, RUDP_HEADER_SIZE + rudp->length, 0, NULL, 0) == -1) {
+                perror("can't send the data");
                 free(rudp);
                 return -1;
             }
+            acked = await_ack(socket, i, 0, bit, clock()) > 0;
+        }
+        if (acked) {
+            continue;
+        }
+
+        // Abandon the segment; past the deadline the whole rest of the message goes
+        abandoned = 1;
+        if (mode == RUDP_DEADLINE &&
+            setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &saved_timeout, sizeof(saved_timeout)) < 0) {
+            perror("Error resetting timeout");
+            free(rudp);
+            return -1;
+        }
+        if (send_skip(socket, i, mode == RUDP_DEADLINE || rudp->flags.fin, bit, options) == -1) {
+            free(rudp);
+            return -1;
+        }
+        if (mode == RUDP_DEADLINE) {
+            break;
         }
     }
-    
+
+    if (mode == RUDP_DEADLINE && !abandoned &&
+        setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &saved_timeout, sizeof(saved_timeout)) < 0) {
+        perror("Error resetting timeout");
+        free(rudp);
+        return -1;
+    }
+
     // Free the allocated memory for the RUDP packet
     free(rudp);
+    if (options != NULL && size > 0) {
+        options->send_bit = !bit;
+    }
 
-    return 1;
+    return abandoned ? 0 : 1;
 }
 
 // Global variable to track the sequence number
 int seq_number = 0;
 
+/*
+ * Hands the data of a segment to the caller in a newly allocated buffer,
+ * decompressing it first when the sender compressed it.
+ */
+static int deliver_segment(RUDP_Packet *rudp, char **buffer, int *size) {
+    if (rudp->length > MAX_PACK_SIZE) {
+        fprintf(stderr, "Invalid segment length\n");
+        return -1;
+    }
+    if (rudp->flags.isCompressed == 0) {
+        *buffer = malloc(rudp->length);
+        if (*buffer == NULL) {
+            perror("Failed to allocate memory for buffer");
+            return -1;
+        }
+        memcpy(*buffer, rudp->data, rudp->length);
+        *size = rudp->length;
+        return 0;
+    }
+
+    uint32_t raw_len;
+    if (rudp->length < sizeof(raw_len)) {
+        fprintf(stderr, "Invalid compressed segment\n");
+        return -1;
+    }
+    memcpy(&raw_len, rudp->data, sizeof(raw_len));
+    raw_len = ntohl(raw_len);
+    if (raw_len == 0 || raw_len > RUDP_MAX_SPAN) {
+        fprintf(stderr, "Invalid compressed segment\n");
+        return -1;
+    }
+    *buffer = malloc(raw_len);
+    if (*buffer == NULL) {
+        perror("Failed to allocate memory for buffer");
+        return -1;
+    }
+    uint64_t start = now_ns();
+    int got = rudp_lz_decompress(rudp->data + sizeof(raw_len), rudp->length - sizeof(raw_len),
+                                 *buffer, raw_len);
+    stats_add(&compress_stats.decompress_ns, now_ns() - start);
+    if (got != (int)raw_len) {
+        fprintf(stderr, "Corrupt compressed segment\n");
+        free(*buffer);
+        *buffer = NULL;
+        return -1;
+    }
+    *size = got;
+    return 0;
+}
+
+/*
+ * Multipath connections. Every path is its own connected UDP socket, path 0
+ * being the socket the connection was made on. Segments share one
+ * connection-wide sequence space and up to RUDP_MP_WINDOW of them are in
+ * flight at once, so the receiver reorders them before delivery.
+ */
+#define RUDP_MAX_CONNECTIONS 8     // Multipath connections per process
+#define RUDP_INITIAL_RTO_MS 200    // Retransmission timeout before a path has an RTT sample
+#define RUDP_MIN_RTO_MS 10         // Lower bound of the retransmission timeout
+#define RUDP_MAX_RTO_MS 1000       // Upper bound of the retransmission timeout
+#define RUDP_PATH_SILENCE_MS 500   // A path this long without an ack is considered down
+#define RUDP_PATH_PROBE_MS 200     // How often a path that is down gets a probe
+#define RUDP_RECEIVE_TIMEOUT_MS 5000
+
+enum { SLOT_FREE, SLOT_PENDING, SLOT_SCHEDULED, SLOT_IN_FLIGHT, SLOT_ACKED, SLOT_READY };
+
+typedef struct Path {
+    int fd;
+    int connected;          // Receiver paths are connected by their join SYN
+    int loss_pct;           // Emulated loss of outgoing data
+    int delay_ms;           // Emulated delay of outgoing data
+    int alive;
+    int cwnd;               // Congestion window in segments
+    int ssthresh;
+    int acked_in_cwnd;
+    int in_flight;
+    int backoff;            // Exponential RTO backoff, reset by an ack
+    uint64_t srtt_ns;
+    uint64_t rttvar_ns;
+    uint64_t last_heard;    // Last ack, or when the path started waiting for one
+    uint64_t dead_since;
+    uint64_t last_loss;     // Segments sent before this already had their loss counted
+    uint64_t sent;
+    uint64_t retransmits;
+} Path;
+
+typedef struct Slot {
+    RUDP_Packet packet;
+    int state;
+    int path;
+    int retx;
+    uint64_t sent_at;       // When the segment was handed to its path
+    uint64_t send_at;       // When it actually leaves, after the emulated delay
+} Slot;
+
+struct Multipath {
+    int used;
+    int socket;
+    int count;
+    int next_poll;          // Path read first next time, so no path starves the others
+    Path paths[RUDP_MAX_PATHS];
+    int next_seq;           // Sender: next sequence number to hand out
+    int base_seq;           // Sender: oldest unacked segment, receiver: next to deliver
+    int joined;             // Receiver: a path joined, so the peer sends over the reorder window
+    Slot *slots;            // RUDP_MP_WINDOW entries indexed by seq % RUDP_MP_WINDOW
+};
+
+static Multipath multipaths[RUDP_MAX_CONNECTIONS];
+
+static Multipath *get_multipath(int socket, int create) {
+    for (int i = 0; i < RUDP_MAX_CONNECTIONS; i++) {
+        if (multipaths[i].used && multipaths[i].socket == socket) {
+            return &multipaths[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    for (int i = 0; i < RUDP_MAX_CONNECTIONS; i++) {
+        Multipath *mp = &multipaths[i];
+        if (mp->used) {
+            continue;
+        }
+        mp->slots = calloc(RUDP_MP_WINDOW, sizeof(Slot));
+        if (mp->slots == NULL) {
+            perror("Failed to allocate memory for multipath window");
+            return NULL;
+        }
+        mp->used = 1;
+        mp->socket = socket;
+        mp->count = 0;
+        mp->next_poll = 0;
+        mp->next_seq = 0;
+        mp->base_seq = 0;
+        mp->joined = 0;
+        return mp;
+    }
+    fprintf(stderr, "Too many multipath connections\n");
+    return NULL;
+}
+
+static int add_path(Multipath *mp, int fd, int connected) {
+    if (mp->count == RUDP_MAX_PATHS) {
+        fprintf(stderr, "Too many paths\n");
+        return -1;
+    }
+    Path *path = &mp->paths[mp->count];
+    memset(path, 0, sizeof(Path));
+    path->fd = fd;
+    path->connected = connected;
+    path->alive = 1;
+    path->cwnd = 4;
+    path->ssthresh = RUDP_MP_WINDOW;
+    path->last_heard = now_ns();
+    return mp->count++;
+}
+
+// Closes the extra paths of a connection, the caller closes the socket itself
+static void drop_multipath(int socket) {
+    Multipath *mp = get_multipath(socket, 0);
+    if (mp == NULL) {
+        return;
+    }
+    for (int i = 1; i < mp->count; i++) {
+        close(mp->paths[i].fd);
+    }
+    free(mp->slots);
+    memset(mp, 0, sizeof(Multipath));
+}
+
+static uint64_t path_rto(const Path *path) {
+    uint64_t rto = path->srtt_ns == 0 ? RUDP_INITIAL_RTO_MS * 1000000ULL
+                                      : path->srtt_ns + 4 * path->rttvar_ns;
+    if (rto < RUDP_MIN_RTO_MS * 1000000ULL) {
+        rto = RUDP_MIN_RTO_MS * 1000000ULL;
+    }
+    rto <<= path->backoff;
+    if (rto > RUDP_MAX_RTO_MS * 1000000ULL) {
+        rto = RUDP_MAX_RTO_MS * 1000000ULL;
+    }
+    return rto;
+}
+
+static void path_on_ack(Path *path, uint64_t rtt, uint64_t now) {
+    if (rtt > 0) {
+        // Smoothed RTT and variance as in RFC 6298
+        if (path->srtt_ns == 0) {
+            path->srtt_ns = rtt;
+            path->rttvar_ns = rtt / 2;
+        } else {
+            uint64_t diff = rtt > path->srtt_ns ? rtt - path->srtt_ns : path->srtt_ns - rtt;
+            path->rttvar_ns = (3 * path->rttvar_ns + diff) / 4;
+            path->srtt_ns = (7 * path->srtt_ns + rtt) / 8;
+        }
+    }
+    if (path->cwnd < path->ssthresh) {
+        path->cwnd++;
+    } else if (++path->acked_in_cwnd >= path->cwnd) {
+        path->cwnd++;
+        path->acked_in_cwnd = 0;
+    }
+    if (path->cwnd > RUDP_MP_WINDOW) {
+        path->cwnd = RUDP_MP_WINDOW;
+    }
+    path->backoff = 0;
+    path->alive = 1;
+    path->last_heard = now;
+}
+
+// Reacts once per window: losses of segments sent before the last reaction are not counted again
+static void path_on_loss(Path *path, uint64_t sent_at, uint64_t now) {
+    path->retransmits++;
+    if (sent_at < path->last_loss) {
+        return;
+    }
+    path->last_loss = now;
+    path->ssthresh = path->cwnd / 2 > 2 ? path->cwnd / 2 : 2;
+    path->cwnd = path->cwnd / 2 > 1 ? path->cwnd / 2 : 1;
+    path->acked_in_cwnd = 0;
+    if (path->backoff < 6) {
+        path->backoff++;
+    }
+}
+
+/*
+ * Picks the path for the next segment: the live path with the lowest
+ * smoothed RTT that still has room in its congestion window. A segment that
+ * timed out avoids the path it was lost on while another path is up.
+ */
+static int pick_path(Multipath *mp, int avoid) {
+    int best = -1;
+    int others_alive = 0;
+    for (int i = 0; i < mp->count; i++) {
+        if (i != avoid && mp->paths[i].alive) {
+            others_alive = 1;
+        }
+    }
+    for (int i = 0; i < mp->count; i++) {
+        Path *path = &mp->paths[i];
+        if (!path->alive || path->in_flight >= path->cwnd || (i == avoid && others_alive)) {
+            continue;
+        }
+        if (best == -1 || path->srtt_ns < mp->paths[best].srtt_ns) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Receives one packet from whichever path has one, waiting up to timeout_ms
+ * (spinning first in low-latency mode). Returns -1 with errno EAGAIN on
+ * timeout.
+ */
+static ssize_t recv_any(Multipath *mp, RUDP_Packet *rudp, int *path, struct sockaddr_in *from,
+                        int timeout_ms) {
+    uint64_t start = now_ns();
+    uint64_t budget = (uint64_t)spin_budget(mp->socket) * 1000;
+    for (;;) {
+        for (int n = 0; n < mp->count; n++) {
+            int i = (mp->next_poll + n) % mp->count;
+            socklen_t len = sizeof(*from);
+            ssize_t got = recvfrom(mp->paths[i].fd, rudp, sizeof(RUDP_Packet), MSG_DONTWAIT,
+                                   (struct sockaddr *)from, &len);
+            if (got >= 0) {
+                mp->next_poll = (i + 1) % mp->count;
+                *path = i;
+                return got;
+            }
+            // Errors such as ECONNREFUSED only concern that path, keep the others going
+        }
+        uint64_t now = now_ns();
+        if (now - start < budget) {
+            continue;
+        }
+        int left_ms = timeout_ms - (int)((now - start) / 1000000);
+        if (left_ms <= 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        struct pollfd fds[RUDP_MAX_PATHS];
+        for (int i = 0; i < mp->count; i++) {
+            fds[i].fd = mp->paths[i].fd;
+            fds[i].events = POLLIN;
+        }
+        if (poll(fds, mp->count, left_ms) == -1 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Turns an abandoned segment into a forward-skip marker that keeps its sequence number
+static void make_skip(Slot *slot) {
+    int seq = slot->packet.sequalNum;
+    int fin = slot->packet.flags.fin;
+    memset(&slot->packet, 0, RUDP_HEADER_SIZE);
+    slot->packet.flags.isSkip = 1;
+    slot->packet.flags.fin = fin;
+    slot->packet.sequalNum = seq;
+    slot->packet.checksum = calculate_checksum(&slot->packet);
+}
+
+static int mp_send(Multipath *mp, const char *data, int size, const RUDP_Policy *policy, int compress) {
+    int mode = policy == NULL ? RUDP_RELIABLE : policy->mode;
+    uint64_t deadline = mode == RUDP_DEADLINE ? now_ns() + (uint64_t)policy->deadline_ms * 1000000ULL : 0;
+    int abandoned = 0;
+    int end_skip = 0;  // The tail was abandoned, a skip marker with fin still has to end the message
+    int offset = 0;
+
+    RUDP_Packet *ack = malloc(sizeof(RUDP_Packet));
+    if (ack == NULL) {
+        perror("Failed to allocate memory for RUDP packet");
+        return -1;
+    }
+
+    mp->base_seq = mp->next_seq;
+    while (offset < size || end_skip || mp->base_seq < mp->next_seq) {
+        uint64_t now = now_ns();
+
+        // Past the deadline nothing new is sent and what is still unacked is skipped
+        if (mode == RUDP_DEADLINE && now >= deadline && !abandoned) {
+            abandoned = offset < size;
+            end_skip = offset < size;
+            offset = size;
+            for (int seq = mp->base_seq; seq < mp->next_seq; seq++) {
+                Slot *slot = &mp->slots[seq % RUDP_MP_WINDOW];
+                if (slot->state == SLOT_ACKED || !slot->packet.flags.isData) {
+                    continue;
+                }
+                if (slot->state == SLOT_SCHEDULED || slot->state == SLOT_IN_FLIGHT) {
+                    mp->paths[slot->path].in_flight--;
+                    slot->retx++;
+                }
+                make_skip(slot);
+                slot->state = SLOT_PENDING;
+                abandoned = 1;
+            }
+        }
+
+        // Fill the window with new segments
+        while (offset < size && mp->next_seq - mp->base_seq < RUDP_MP_WINDOW) {
+            Slot *slot = &mp->slots[mp->next_seq % RUDP_MP_WINDOW];
+            offset += rudp_build_segment(&slot->packet, mp->next_seq++, data + offset, size - offset, compress);
+            slot->state = SLOT_PENDING;
+            slot->retx = 0;
+        }
+        if (end_skip && mp->next_seq - mp->base_seq < RUDP_MP_WINDOW) {
+            Slot *slot = &mp->slots[mp->next_seq % RUDP_MP_WINDOW];
+            slot->packet.sequalNum = mp->next_seq++;
+            slot->packet.flags.fin = 1;
+            make_skip(slot);
+            slot->state = SLOT_PENDING;
+            slot->retx = 0;
+            end_skip = 0;
+        }
+
+        for (int seq = mp->base_seq; seq < mp->next_seq; seq++) {
+            Slot *slot = &mp->slots[seq % RUDP_MP_WINDOW];
+
+            // Hand pending segments to the best path
+            if (slot->state == SLOT_PENDING) {
+                int p = pick_path(mp, slot->retx > 0 ? slot->path : -1);
+                if (p == -1) {
+                    continue;
+                }
+                Path *path = &mp->paths[p];
+                if (path->in_flight++ == 0) {
+                    path->last_heard = now;
+                }
+                slot->path = p;
+                slot->sent_at = now;
+                slot->send_at = now + (uint64_t)path->delay_ms * 1000000ULL;
+                slot->state = SLOT_SCHEDULED;
+            }
+
+            // Transmit the ones whose emulated delay is over
+            Path *path = &mp->paths[slot->path];
+            if (slot->state == SLOT_SCHEDULED && now >= slot->send_at) {
+                slot->state = SLOT_IN_FLIGHT;
+                path->sent++;
+                if (rand() % 100 >= path->loss_pct) {
+                    // A failing path looks like loss, the timeout moves the segment elsewhere
+                    sendto(path->fd, &slot->packet, RUDP_HEADER_SIZE + slot->packet.length, 0, NULL, 0);
+                }
+            }
+
+            // Retransmission timeout: back to pending, possibly on another path
+            if ((slot->state == SLOT_SCHEDULED || slot->state == SLOT_IN_FLIGHT) &&
+                now - slot->sent_at > path_rto(path)) {
+                path->in_flight--;
+                path_on_loss(path, slot->sent_at, now);
+                slot->state = SLOT_PENDING;
+                slot->retx++;
+                if (mode == RUDP_MAX_RETX && slot->retx > policy->max_retx && slot->packet.flags.isData) {
+                    make_skip(slot);
+                    abandoned = 1;
+                }
+            }
+        }
+
+        // Fail over from paths that went silent, probing them with a copy of the oldest segment
+        for (int p = 0; p < mp->count; p++) {
+            Path *path = &mp->paths[p];
+            if (!path->alive && mp->base_seq < mp->next_seq &&
+                now - path->dead_since >= RUDP_PATH_PROBE_MS * 1000000ULL) {
+                RUDP_Packet *probe = &mp->slots[mp->base_seq % RUDP_MP_WINDOW].packet;
+                path->dead_since = now;
+                if (rand() % 100 >= path->loss_pct) {
+                    sendto(path->fd, probe, RUDP_HEADER_SIZE + probe->length, 0, NULL, 0);
+                }
+            }
+            if (!path->alive || path->in_flight == 0 ||
+                now - path->last_heard < RUDP_PATH_SILENCE_MS * 1000000ULL) {
+                continue;
+            }
+            path->alive = 0;
+            path->dead_since = now;
+            path->cwnd = 1;
+            path->in_flight = 0;
+            for (int seq = mp->base_seq; seq < mp->next_seq; seq++) {
+                Slot *slot = &mp->slots[seq % RUDP_MP_WINDOW];
+                if (slot->path == p && (slot->state == SLOT_SCHEDULED || slot->state == SLOT_IN_FLIGHT)) {
+                    slot->state = SLOT_PENDING;
+                    slot->retx++;
+                }
+            }
+        }
+
+        // Wait a little for acks, then take everything that is queued
+        int p;
+        struct sockaddr_in from;
+        int wait_ms = 1;
+        while (recv_any(mp, ack, &p, &from, wait_ms) >= 0) {
+            wait_ms = 0;
+            now = now_ns();
+            Path *path = &mp->paths[p];
+            if (!path->alive) {
+                // A probe got through, the path is back with a fresh window
+                path->alive = 1;
+                path->cwnd = 1;
+                path->backoff = 0;
+                path->last_heard = now;
+            }
+            // A late SYN-ACK of a path join is not the ack of segment 0
+            if (!ack->flags.ack || ack->flags.isSyn || ack->sequalNum < mp->base_seq ||
+                ack->sequalNum >= mp->next_seq) {
+                continue;
+            }
+            Slot *slot = &mp->slots[ack->sequalNum % RUDP_MP_WINDOW];
+            if (slot->state == SLOT_ACKED) {
+                continue;
+            }
+            if (slot->state == SLOT_SCHEDULED || slot->state == SLOT_IN_FLIGHT) {
+                mp->paths[slot->path].in_flight--;
+            }
+            // Karn: only segments sent once give an RTT sample
+            int sample = slot->retx == 0 && slot->path == p && slot->state == SLOT_IN_FLIGHT;
+            path_on_ack(path, sample ? now - slot->sent_at : 0, now);
+            slot->state = SLOT_ACKED;
+        }
+
+        // Slide the window over the acked segments
+        while (mp->base_seq < mp->next_seq && mp->slots[mp->base_seq % RUDP_MP_WINDOW].state == SLOT_ACKED) {
+            mp->slots[mp->base_seq % RUDP_MP_WINDOW].state = SLOT_FREE;
+            mp->base_seq++;
+        }
+    }
+
+    free(ack);
+    return abandoned ? 0 : 1;
+}
+
+static int finish_close(int socket);
+
+static int handle_packet(int socket, RUDP_Packet *rudp, char **buffer, int *size);
+
+/*
+ * Receives over the reorder window. Until a path joins, the peer may be a
+ * plain single-path sender whose messages restart at sequence 0, so what
+ * arrives on path 0 before that is handled like on a single-path socket.
+ */
+static int mp_receive(Multipath *mp, int socket, char **buffer, int *size) {
+    RUDP_Packet *rudp = malloc(sizeof(RUDP_Packet));
+    if (rudp == NULL) {
+        perror("Failed to allocate memory for RUDP packet");
+        return -1;
+    }
+
+    for (int received = 0;; received = 1) {
+        // Deliver the next segment in order once it is here, skipping abandoned ones
+        Slot *head = &mp->slots[mp->base_seq % RUDP_MP_WINDOW];
+        while (head->state == SLOT_READY) {
+            head->state = SLOT_FREE;
+            mp->base_seq++;
+            if (head->packet.flags.isSkip) {
+                if (head->packet.flags.fin) {
+                    // The rest of the message was abandoned, end it here
+                    free(rudp);
+                    *buffer = NULL;
+                    *size = 0;
+                    return 5;
+                }
+                head = &mp->slots[mp->base_seq % RUDP_MP_WINDOW];
+                continue;
+            }
+            free(rudp);
+            if (deliver_segment(&head->packet, buffer, size) == -1) {
+                return -1;
+            }
+            return head->packet.flags.fin ? 5 : 1;
+        }
+        if (received) {
+            free(rudp);
+            return 0;
+        }
+
+        int p;
+        struct sockaddr_in from;
+        if (recv_any(mp, rudp, &p, &from, RUDP_RECEIVE_TIMEOUT_MS) == -1) {
+            perror("Failed to receive data");
+            free(rudp);
+            return -1;
+        }
+        Path *path = &mp->paths[p];
+        if (p == 0 && !mp->joined) {
+            return handle_packet(socket, rudp, buffer, size);
+        }
+
+        // A new path joins: connect it to where the join came from
+        if (rudp->flags.isSyn == 1) {
+            if (!path->connected && connect(path->fd, (struct sockaddr *)&from, sizeof(from)) == -1) {
+                perror("Connection failed");
+                free(rudp);
+                return -1;
+            }
+            path->connected = 1;
+            memset(rudp, 0, sizeof(RUDP_Packet));
+            rudp->flags.isSyn = 1;
+            rudp->flags.ack = 1;
+            if (sendto(path->fd, rudp, sizeof(RUDP_Packet), 0, NULL, 0) == -1) {
+                perror("Failed to send data");
+                free(rudp);
+                return -1;
+            }
+            mp->joined = mp->joined || p > 0;
+            printf("Path %d joined\n", p);
+            continue;
+        }
+
+        // Verify checksum
+        if (calculate_checksum(rudp) != rudp->checksum) {
+            free(rudp);
+            return -1;
+        }
+
+        // Data and skip markers go into the reorder window, duplicates are acked again
+        if (rudp->flags.isData == 1 || rudp->flags.isSkip == 1) {
+            int seq = rudp->sequalNum;
+            if (seq >= mp->base_seq + RUDP_MP_WINDOW || rudp->length > MAX_PACK_SIZE) {
+                continue;  // No ack, the sender tries again once the window moved
+            }
+            if (sending_ack(path->fd, rudp) == -1) {
+                free(rudp);
+                return -1;
+            }
+            Slot *slot = &mp->slots[seq % RUDP_MP_WINDOW];
+            if (seq >= mp->base_seq && slot->state == SLOT_FREE) {
+                memcpy(&slot->packet, rudp, RUDP_HEADER_SIZE + rudp->length);
+                slot->state = SLOT_READY;
+            }
+            continue;
+        }
+
+        // Handle connection close
+        if (rudp->flags.fin == 1) {
+            if (sending_ack(path->fd, rudp) == -1) {
+                free(rudp);
+                return -1;
+            }
+            free(rudp);
+            return finish_close(socket);
+        }
+    }
+}
+
 int rudp_receive(int socket, char **buffer, int *size) {
+    // Connections with extra paths reorder segments from all of them
+    Multipath *mp = get_multipath(socket, 0);
+    if (mp != NULL) {
+        return mp_receive(mp, socket, buffer, size);
+    }
+
     // Allocate memory for the RUDP packet
     RUDP_Packet *rudp = malloc(sizeof(RUDP_Packet));
     if (rudp == NULL) {
@@ -117,12 +983,16 @@ int rudp_receive(int socket, char **buffer, int *size) {
     }
 
     // Receive packet from socket
-    if (recvfrom(socket, rudp, sizeof(RUDP_Packet) - 1, 0, NULL, 0) == -1) {
+    if (recv_packet(socket, rudp, sizeof(RUDP_Packet)) == -1) {
         perror("Failed to receive data");
         free(rudp);
         return -1;
     }
+    return handle_packet(socket, rudp, buffer, size);
+}
 
+// Acks and delivers one packet of a single-path connection, and frees it
+static int handle_packet(int socket, RUDP_Packet *rudp, char **buffer, int *size) {
     // Reset timeout value for the socket
     timeout.tv_sec = 0;  // Set timeout to 0 seconds
     timeout.tv_usec = 0;
@@ -150,7 +1020,40 @@ int rudp_receive(int socket, char **buffer, int *size) {
         free(rudp);
         return 0;
     }
+
+    // A late copy from the previous message was acked again above, it has nothing new
+    SocketOptions *options = get_options(socket);
+    int bit = options == NULL ? 0 : options->recv_bit;
+    if ((rudp->flags.isData == 1 || rudp->flags.isSkip == 1) && rudp->flags.msgBit != bit) {
+        free(rudp);
+        return 0;
+    }
     
+    // Handle forward-skip marker: the sender abandoned this segment, move past it
+    if (rudp->flags.isSkip == 1) {
+        if (rudp->sequalNum == seq_number && rudp->flags.fin == 0) {
+            seq_number++;
+        } else if (rudp->flags.fin == 1 && rudp->sequalNum <= seq_number) {
+            // The rest of the message was abandoned, end it here and wait for the next one
+            free(rudp);
+            seq_number = 0;
+            if (options != NULL) {
+                options->recv_bit = !bit;
+            }
+            timeout.tv_sec = 0;  // Set timeout to 0 seconds
+            timeout.tv_usec = 0;
+            if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+                perror("Error resetting timeout");
+                return -1;
+            }
+            *buffer = NULL;
+            *size = 0;
+            return 5;
+        }
+        free(rudp);
+        return 0;
+    }
+
     // Handle data packet
     if (rudp->sequalNum == seq_number) {
         if (rudp->sequalNum == 0 && rudp->flags.isData == 1) {
@@ -164,16 +1067,15 @@ int rudp_receive(int socket, char **buffer, int *size) {
             }
         }
         if (rudp->flags.fin == 1 && rudp->flags.isData == 1) {
-            *buffer = malloc(rudp->length);
-            if (*buffer == NULL) {
-                perror("Failed to allocate memory for buffer");
+            if (deliver_segment(rudp, buffer, size) == -1) {
                 free(rudp);
                 return -1;
             }
-            memcpy(*buffer, rudp->data, rudp->length);
-            *size = rudp->length;
             free(rudp);
             seq_number = 0;
+            if (options != NULL) {
+                options->recv_bit = !bit;
+            }
             // Reset timeout value for the socket
             timeout.tv_sec = 0;  // Set timeout to 0 seconds
             timeout.tv_usec = 0;
@@ -184,14 +1086,10 @@ int rudp_receive(int socket, char **buffer, int *size) {
             return 5;
         }
         if (rudp->flags.isData == 1) {
-            *buffer = malloc(rudp->length);
-            if (*buffer == NULL) {
-                perror("Failed to allocate memory for buffer");
+            if (deliver_segment(rudp, buffer, size) == -1) {
                 free(rudp);
                 return -1;
             }
-            memcpy(*buffer, rudp->data, rudp->length);
-            *size= rudp->length;
             free(rudp);
             seq_number++;
             return 1;
@@ -207,42 +1105,26 @@ int rudp_receive(int socket, char **buffer, int *size) {
     // Handle connection close
     if (rudp->flags.fin == 1) {
         free(rudp);
-        printf("Connection closed by sender\n");
-        // Set timeout for subsequent packets
-        timeout.tv_sec = 5;  // Set timeout to 5 seconds
-        timeout.tv_usec = 0;
-        if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-            perror("Error setting timeout");
-            return -1;
-        }
-        rudp = malloc(sizeof(RUDP_Packet));
-        if (rudp == NULL) {
-            perror("Failed to allocate memory for RUDP packet");
-            return -1;
-        }
-        time_t finishing = time(NULL);
-        printf("Waiting for the statictics...\n");
-
-        while ((double)(time(NULL) - finishing) < 1) {
-            memset(rudp, 0, sizeof(RUDP_Packet));
-            recvfrom(socket, rudp, sizeof(RUDP_Packet) - 1, 0, NULL, 0);
-            if (rudp->flags.fin == 1) {
-                if (sending_ack(socket, rudp) == -1) {
-                    free(rudp);
-                    return -1;
-                }
-                finishing = time(NULL);
-            }
-        }
-        free(rudp);
-        close(socket);
-        return -5;
+        return finish_close(socket);
     }
     
     free(rudp);
     return 0;
 }
 
+/*
+ * The sender closed the connection and its FIN has been acked: the socket
+ * lingers in TIME_WAIT on the timer thread to answer a retransmitted FIN in
+ * case the FIN-ACK got lost, while the caller gets on with its work.
+ */
+static int finish_close(int socket) {
+    printf("Connection closed by sender\n");
+    drop_multipath(socket);
+    rudp_reset_socket(socket);
+    rudp_timer_add_close(socket, RUDP_CLOSE_TIME_WAIT);
+    return -5;
+}
+
 
 int rudp_connect(int socket, const char *ip,unsigned short int port) {
     // Set timeout for socket operations
@@ -334,7 +1216,7 @@ int rudp_accept(int socket, unsigned short int port) {
     // Receive synchronization packet from client
     RUDP_Packet *rudp = malloc(sizeof(RUDP_Packet));
     memset(rudp, 0, sizeof(RUDP_Packet));
-    if (recvfrom(socket, rudp, sizeof(RUDP_Packet) - 1, 0, (struct sockaddr *)&client_address, &len) == -1) {
+    if (recvfrom(socket, rudp, sizeof(RUDP_Packet), 0, (struct sockaddr *)&client_address, &len) == -1) {
         perror("Failed to receive data");
         free(rudp);
         return -1;
@@ -383,16 +1265,23 @@ int rudp_close(int socket) {
   temp->flags.fin = 1;  // Finished so closing the connection
   temp->checksum = calculate_checksum(temp);
   temp->sequalNum = -1;
-  while (waiting_ack(socket, -1, clock(), 1) <= 0) {
-    if (sendto(socket, temp, sizeof(RUDP_Packet), 0, NULL, 0) == -1) {
-      perror("Fialed sendto when closing");
-      free(temp);
-      return -1;  // for error
-    }
+  drop_multipath(socket);
+  rudp_reset_socket(socket);
+  if (sendto(socket, temp, RUDP_HEADER_SIZE, 0, NULL, 0) == -1) {
+    perror("Fialed sendto when closing");
+    close(socket);
+    free(temp);
+    return -1;  // for error
   }
-  close(socket);
   free(temp);
-  return 1;  // succeeded to close the socket and freeing our rudp struct
+  // FIN_WAIT: the timer thread retransmits the FIN until the FIN-ACK, then closes the socket
+  rudp_timer_add_close(socket, RUDP_CLOSE_FIN_WAIT);
+  return 1;  // succeeded, the socket is closed in the background
+}
+
+
+int rudp_drain(int timeout_ms) {
+  return rudp_timer_drain(timeout_ms);
 }
 
 
@@ -405,23 +1294,7 @@ int calculate_checksum(RUDP_Packet *rudp) {
 
 
 int waiting_ack(int socket, int sequal_num, clock_t s, clock_t t) {
-  RUDP_Packet *temp = (RUDP_Packet*) malloc(sizeof(RUDP_Packet));
-  if (temp == NULL){
-    fprintf(stderr, "error allocating memory for sending ack");
-    return -1;
-  }
-  while ((double)(clock() - s) / CLOCKS_PER_SEC < 1) {
-    if (recvfrom(socket, temp, sizeof(RUDP_Packet) - 1, 0, NULL, 0) == -1) {
-      free(temp);
-      return -1;
-    }
-    if (temp->sequalNum == sequal_num && temp->flags.ack) {
-      free(temp);
-      return 1;
-    }
-  }
-  free(temp);
-  return -1;
+  return await_ack(socket, sequal_num, 0, -1, s);
 }
 
 
@@ -434,6 +1307,8 @@ int sending_ack(int socket, RUDP_Packet *rudp) {
     }
     memset(ack, 0, sizeof(RUDP_Packet));
     ack->flags.ack = 1;
+    ack->flags.isSkip = rudp->flags.isSkip;  // Tells the ack of a marker from the ack of the data it replaces
+    ack->flags.msgBit = rudp->flags.msgBit;
     ack->checksum = calculate_checksum(ack);
     ack->sequalNum = rudp->sequalNum;
     // Send the acknowledgment packet
@@ -445,3 +1320,195 @@ int sending_ack(int socket, RUDP_Packet *rudp) {
     free(ack);
     return 1;
 }
+
+
+int rudp_set_low_latency(int socket, int spin_us, int cpu) {
+    if (spin_us < 0) {
+        fprintf(stderr, "Invalid spin budget\n");
+        return -1;
+    }
+    SocketOptions *options = get_options(socket);
+    if (options == NULL) {
+        fprintf(stderr, "Socket out of range for the low-latency mode\n");
+        return -1;
+    }
+    __atomic_store_n(&options->spin_us, spin_us, __ATOMIC_RELAXED);
+
+    // Kernel-side busy polling is only a hint, the user-space spin works without it
+    setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &spin_us, sizeof(spin_us));
+#ifdef SO_PREFER_BUSY_POLL
+    int prefer = spin_us > 0;
+    setsockopt(socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+
+    // Pin the calling thread, which is the one doing the polling
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("Failed to pin the polling thread");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+void rudp_get_poll_stats(RUDP_PollStats *stats) {
+    stats->spin_ns = __atomic_load_n(&poll_stats.spin_ns, __ATOMIC_RELAXED);
+    stats->sleep_ns = __atomic_load_n(&poll_stats.sleep_ns, __ATOMIC_RELAXED);
+    stats->spin_hits = __atomic_load_n(&poll_stats.spin_hits, __ATOMIC_RELAXED);
+    stats->sleep_hits = __atomic_load_n(&poll_stats.sleep_hits, __ATOMIC_RELAXED);
+}
+
+
+void rudp_reset_poll_stats(void) {
+    __atomic_store_n(&poll_stats.spin_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&poll_stats.sleep_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&poll_stats.spin_hits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&poll_stats.sleep_hits, 0, __ATOMIC_RELAXED);
+}
+
+
+int rudp_set_link_rate(int socket, int kbit_per_s) {
+    SocketOptions *options = get_options(socket);
+    if (options == NULL || kbit_per_s < 0) {
+        fprintf(stderr, "Invalid link rate\n");
+        return -1;
+    }
+    options->rate_kbps = kbit_per_s;
+    options->link_free_at = 0;
+    return 0;
+}
+
+
+int rudp_set_compression(int socket, int enabled) {
+    SocketOptions *options = get_options(socket);
+    if (options == NULL) {
+        fprintf(stderr, "Socket out of range for compression\n");
+        return -1;
+    }
+    options->compress = enabled != 0;
+    return 0;
+}
+
+
+void rudp_get_compress_stats(RUDP_CompressStats *stats) {
+    stats->raw_bytes = __atomic_load_n(&compress_stats.raw_bytes, __ATOMIC_RELAXED);
+    stats->wire_bytes = __atomic_load_n(&compress_stats.wire_bytes, __ATOMIC_RELAXED);
+    stats->bypassed = __atomic_load_n(&compress_stats.bypassed, __ATOMIC_RELAXED);
+    stats->compress_ns = __atomic_load_n(&compress_stats.compress_ns, __ATOMIC_RELAXED);
+    stats->decompress_ns = __atomic_load_n(&compress_stats.decompress_ns, __ATOMIC_RELAXED);
+}
+
+
+void rudp_reset_compress_stats(void) {
+    __atomic_store_n(&compress_stats.raw_bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&compress_stats.wire_bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&compress_stats.bypassed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&compress_stats.compress_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&compress_stats.decompress_ns, 0, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Adds a ready path to the connection, making it a multipath one on its first
+ * extra path. On failure the path is closed and the connection left as it was.
+ */
+static int attach_path(int socket, int fd, int connected) {
+    Multipath *mp = get_multipath(socket, 1);
+    if (mp == NULL) {
+        close(fd);
+        return -1;
+    }
+    if (mp->count == 0) {
+        add_path(mp, socket, 1);
+    }
+    int path = add_path(mp, fd, connected);
+    if (path == -1) {
+        close(fd);
+        if (mp->count <= 1) {
+            drop_multipath(socket);
+        }
+    }
+    return path;
+}
+
+
+int rudp_add_path(int socket, const char *local_ip, const char *remote_ip, unsigned short int port) {
+    // Bind the path to its local address, then handshake like rudp_connect
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    if (inet_pton(AF_INET, local_ip, &local.sin_addr) <= 0) {
+        perror("Invalid IP address");
+        return -1;
+    }
+    int fd = rudp_socket();
+    if (fd == -1) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) == -1) {
+        perror("Binding failed");
+        close(fd);
+        return -1;
+    }
+    if (rudp_connect(fd, remote_ip, port) <= 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Only a path that is up turns the connection into a multipath one
+    return attach_path(socket, fd, 1);
+}
+
+
+int rudp_listen_path(int socket, const char *local_ip, unsigned short int port) {
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    if (inet_pton(AF_INET, local_ip, &local.sin_addr) <= 0) {
+        perror("Invalid IP address");
+        return -1;
+    }
+    int fd = rudp_socket();
+    if (fd == -1) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) == -1) {
+        perror("Binding failed");
+        close(fd);
+        return -1;
+    }
+    // Connected once the sender's join arrives, see mp_receive
+    return attach_path(socket, fd, 0);
+}
+
+
+int rudp_set_path_impairment(int socket, int path, int loss_pct, int delay_ms) {
+    Multipath *mp = get_multipath(socket, 0);
+    if (mp == NULL || path < 0 || path >= mp->count || loss_pct < 0 || loss_pct > 100 || delay_ms < 0) {
+        fprintf(stderr, "Invalid path impairment\n");
+        return -1;
+    }
+    mp->paths[path].loss_pct = loss_pct;
+    mp->paths[path].delay_ms = delay_ms;
+    return 0;
+}
+
+
+int rudp_get_path_stats(int socket, int path, RUDP_PathStats *stats) {
+    Multipath *mp = get_multipath(socket, 0);
+    if (mp == NULL || path < 0 || path >= mp->count) {
+        return -1;
+    }
+    Path *p = &mp->paths[path];
+    stats->srtt_us = p->srtt_ns / 1000;
+    stats->cwnd = p->cwnd;
+    stats->alive = p->alive;
+    stats->sent = p->sent;
+    stats->retransmits = p->retransmits;
+    return 0;
+}
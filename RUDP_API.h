@@ -23,8 +23,48 @@ typedef struct Flags {
   uint8_t ack;   /**< Indicates acknowledgment. */
   uint8_t isSyn;    /**< Indicates synchronization. */
   uint8_t isData;      /**< Indicates data packet. */
+  uint8_t isSkip;      /**< Indicates a forward-skip marker for an abandoned segment. */
+  uint8_t isCompressed; /**< Indicates the data is a compressed block. */
+  uint8_t msgBit;      /**< Alternates per message, so late segments of the previous message are recognized. */
 }Flags;
 
+#define RUDP_RELIABLE 0   /**< Retransmit every segment until it is acknowledged. */
+#define RUDP_MAX_RETX 1   /**< Abandon a segment after max_retx retransmissions. */
+#define RUDP_DEADLINE 2   /**< Abandon the rest of the message once the deadline passes. */
+
+/**
+ * @struct RUDP_Policy
+ * @brief Struct to describe the reliability policy of a single message.
+ */
+typedef struct RUDP_Policy {
+  int mode;          /**< One of RUDP_RELIABLE, RUDP_MAX_RETX or RUDP_DEADLINE. */
+  int max_retx;      /**< Retransmissions allowed per segment in RUDP_MAX_RETX mode. */
+  int deadline_ms;   /**< Lifetime of the message in milliseconds in RUDP_DEADLINE mode. */
+} RUDP_Policy;
+
+/**
+ * @struct RUDP_PollStats
+ * @brief Struct to report where the low-latency mode spent its waiting time.
+ */
+typedef struct RUDP_PollStats {
+  uint64_t spin_ns;      /**< Nanoseconds spent busy-polling with MSG_DONTWAIT. */
+  uint64_t sleep_ns;     /**< Nanoseconds spent blocked in recvfrom after the spin budget. */
+  uint64_t spin_hits;    /**< Packets received while spinning. */
+  uint64_t sleep_hits;   /**< Packets received after falling back to blocking. */
+} RUDP_PollStats;
+
+/**
+ * @struct RUDP_CompressStats
+ * @brief Struct to report the effect and cost of the compression stage.
+ */
+typedef struct RUDP_CompressStats {
+  uint64_t raw_bytes;       /**< Payload bytes submitted to the compression stage. */
+  uint64_t wire_bytes;      /**< Payload bytes sent after the compression stage. */
+  uint64_t bypassed;        /**< Messages sent raw because their sample looked random. */
+  uint64_t compress_ns;     /**< Nanoseconds spent sampling and compressing. */
+  uint64_t decompress_ns;   /**< Nanoseconds spent decompressing received segments. */
+} RUDP_CompressStats;
+
 /**
  * @typedef RUDP_Packet
  * @brief Typedef for RUDP packet structure.
@@ -37,6 +77,24 @@ typedef struct _RUDP {
   char data[MAX_PACK_SIZE];    /**< Data in the packet. */
 } RUDP_Packet;
 
+#define RUDP_HEADER_SIZE offsetof(RUDP_Packet, data)  /**< Bytes of a packet before its data. */
+#define RUDP_MAX_SPAN (16 * MAX_PACK_SIZE)  /**< Most raw bytes one compressed segment may cover. */
+#define RUDP_ENTROPY_BYPASS 7.5  /**< Sampled bits per byte above which a message is sent raw. */
+#define RUDP_MAX_PATHS 4  /**< Most paths of a multipath connection, including the first one. */
+#define RUDP_MP_WINDOW 64  /**< Most segments of a multipath connection in flight at once. */
+
+/**
+ * @struct RUDP_PathStats
+ * @brief Struct to report the state of one path of a multipath connection.
+ */
+typedef struct RUDP_PathStats {
+  uint64_t srtt_us;       /**< Smoothed round-trip time in microseconds. */
+  int cwnd;               /**< Congestion window in segments. */
+  int alive;              /**< 0 once the path went silent and traffic failed over. */
+  uint64_t sent;          /**< Segments sent on the path. */
+  uint64_t retransmits;   /**< Retransmission timeouts on the path. */
+} RUDP_PathStats;
+
 /**
  * @brief Creates a new RUDP socket.
  * @return File descriptor of the created socket, or -1 on failure.
@@ -52,22 +110,48 @@ int rudp_socket();
  */
 int rudp_send(int socket, const char *data, int size);
 
+/**
+ * @brief Sends data over the RUDP connection under a partial-reliability policy.
+ * Abandoned segments are replaced by a forward-skip marker so the receiver
+ * advances past them instead of waiting.
+ * @param socket File descriptor of the RUDP socket.
+ * @param data Pointer to the data to be sent.
+ * @param size Size of the data to be sent.
+ * @param policy Reliability policy of the message, or NULL for fully reliable.
+ * @return 1 if every segment was delivered, 0 if some were abandoned, or -1 on failure.
+ */
+int rudp_send_ex(int socket, const char *data, int size, const RUDP_Policy *policy);
+
 /**
  * @brief Receives data over the RUDP connection.
  * @param socket File descriptor of the RUDP socket.
  * @param buffer Pointer to the buffer to store received data.
  * @param size Pointer to the variable to store the length of received data.
- * @return 0 on success, or -1 on failure.
+ * @return 1 for a segment in the middle of a message, 5 for the last segment
+ * of a message, 0 when nothing was delivered, or -1 on failure. When the sender
+ * abandons the rest of a message it returns 5 with *buffer NULL and *size 0.
+ * When the sender closes the connection it returns -5 at once and the socket is
+ * closed in the background.
  */
 int rudp_receive(int socket, char **buffer, int *size);
 
 /**
  * @brief Closes the RUDP socket.
+ * Sends the FIN and returns right away; retransmitting the FIN until the
+ * FIN-ACK arrives and closing the socket happen on the timer thread.
  * @param socket File descriptor of the RUDP socket.
- * @return 0 on success, or -1 on failure.
+ * @return 1 on success, or -1 on failure.
  */
 int rudp_close(int socket);
 
+/**
+ * @brief Waits for sockets closed in the background to finish closing.
+ * Call before the process exits so pending FINs still get retransmitted.
+ * @param timeout_ms Longest time to wait in milliseconds.
+ * @return Number of sockets still closing when the wait ended.
+ */
+int rudp_drain(int timeout_ms);
+
 /**
  * @brief Connects to a remote RUDP socket.
  * @param socket File descriptor of the RUDP socket.
@@ -93,7 +177,7 @@ int rudp_accept(int sockfd,  unsigned short int port);
 int calculate_checksum(RUDP_Packet *rudp);
 
 /**
- * @brief Waits for an acknowledgment packet.
+ * @brief Waits for the acknowledgment of a data packet (acks of skip markers do not count).
  * @param socket File descriptor of the RUDP socket.
  * @param seq_num Expected sequence number of the acknowledgment packet.
  * @param start_time Start time of the waiting period.
@@ -103,11 +187,106 @@ int calculate_checksum(RUDP_Packet *rudp);
 int waiting_ack(int socket, int seq_num, clock_t start_time, clock_t timeout);
 
 /**
- * @brief Sends an acknowledgment packet.
+ * @brief Sends an acknowledgment packet, which echoes the isSkip and msgBit flags of the packet.
  * @param socket File descriptor of the RUDP socket.
  * @param rudp Pointer to the RUDP packet for which the acknowledgment is sent.
  * @return 1 on success, or -1 on failure.
  */
 int sending_ack(int socket, RUDP_Packet *rudp);
 
+/**
+ * @brief Enables or disables the low-latency busy-poll mode.
+ * Receives first spin with MSG_DONTWAIT for up to spin_us microseconds
+ * (with SO_BUSY_POLL/SO_PREFER_BUSY_POLL hinting the kernel), then fall back
+ * to the regular blocking recvfrom under SO_RCVTIMEO. Only receives on this
+ * socket spin, other sockets of the process keep blocking.
+ * @param socket File descriptor of the RUDP socket.
+ * @param spin_us Spin budget in microseconds, 0 disables the mode.
+ * @param cpu CPU to pin the calling (polling) thread to, or -1 for no pinning.
+ * @return 0 on success, or -1 on failure.
+ */
+int rudp_set_low_latency(int socket, int spin_us, int cpu);
+
+/**
+ * @brief Copies the busy-poll statistics collected so far by all threads and sockets.
+ * @param stats Pointer to the struct to fill.
+ */
+void rudp_get_poll_stats(RUDP_PollStats *stats);
+
+/**
+ * @brief Resets the busy-poll statistics to zero.
+ */
+void rudp_reset_poll_stats(void);
+
+/**
+ * @brief Enables or disables the compression stage of rudp_send on one socket.
+ * Each message is sampled first, and messages that look random are sent raw.
+ * @param socket File descriptor of the RUDP socket.
+ * @param enabled 1 to compress outgoing messages, 0 to send them raw.
+ * @return 0 on success, or -1 on failure.
+ */
+int rudp_set_compression(int socket, int enabled);
+
+/**
+ * @brief Emulates a bandwidth-limited link under the data rudp_send sends on a
+ * single-path socket, by pacing each segment to the time the link needs to
+ * serialize it. Segments striped over extra paths are not paced.
+ * @param socket File descriptor of the RUDP socket.
+ * @param kbit_per_s Link rate in kbit/s, 0 for no limit.
+ * @return 0 on success, or -1 on failure.
+ */
+int rudp_set_link_rate(int socket, int kbit_per_s);
+
+/**
+ * @brief Copies the compression statistics collected so far by all threads and sockets.
+ * @param stats Pointer to the struct to fill.
+ */
+void rudp_get_compress_stats(RUDP_CompressStats *stats);
+
+/**
+ * @brief Resets the compression statistics to zero.
+ */
+void rudp_reset_compress_stats(void);
+
+/**
+ * @brief Opens an extra path of a connection over another local/remote address pair.
+ * Once a connection has extra paths, rudp_send stripes segments across all of
+ * them by RTT and congestion window and fails over from paths that go silent.
+ * @param socket File descriptor of the connected RUDP socket (path 0).
+ * @param local_ip Local IP address to send the path from.
+ * @param remote_ip IP address the receiver listens on for this path.
+ * @param port Port number the receiver listens on for this path.
+ * @return Index of the new path on success, or -1 on failure.
+ */
+int rudp_add_path(int socket, const char *local_ip, const char *remote_ip, unsigned short int port);
+
+/**
+ * @brief Listens for an extra path of a connection on the receiving side.
+ * Must be called before rudp_accept, the sender's join is answered by rudp_receive.
+ * @param socket File descriptor of the RUDP socket (path 0).
+ * @param local_ip Local IP address to listen on.
+ * @param port Port number to listen on, different from the one given to rudp_accept.
+ * @return Index of the new path on success, or -1 on failure.
+ */
+int rudp_listen_path(int socket, const char *local_ip, unsigned short int port);
+
+/**
+ * @brief Emulates loss and delay on the data sent over one path, for local testing.
+ * @param socket File descriptor of the RUDP socket.
+ * @param path Index of the path.
+ * @param loss_pct Percentage of segments to drop (100 silences the path).
+ * @param delay_ms Delay added before each segment leaves.
+ * @return 0 on success, or -1 on failure.
+ */
+int rudp_set_path_impairment(int socket, int path, int loss_pct, int delay_ms);
+
+/**
+ * @brief Copies the state of one path of a multipath connection.
+ * @param socket File descriptor of the RUDP socket.
+ * @param path Index of the path.
+ * @param stats Pointer to the struct to fill.
+ * @return 0 on success, or -1 if there is no such path.
+ */
+int rudp_get_path_stats(int socket, int path, RUDP_PathStats *stats);
+
 #endif 
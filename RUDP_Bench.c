@@ -0,0 +1,433 @@
+#include <pthread.h>     // For the receiving thread of the socketpair benchmarks
+#include <stdio.h>       // For standard input/output operations
+#include <stdlib.h>      // For standard library functions
+#include <string.h>      // For string manipulation functions
+#include <sys/socket.h>  // For socket-related functions
+#include <sys/time.h>    // For time-related functions
+#include <time.h>        // For time-related functions
+#include <unistd.h>      // For standard symbolic constants and types
+
+#include "RUDP_API.h"       // Header file for the Reliable UDP (RUDP) API
+#include "RUDP_Compress.h"  // Header file for the compression stage
+#include "RUDP_Internal.h"  // Header file for the internals under benchmark
+
+#define MIN_BENCH_NS 200000000ULL  // The measured batch of each benchmark lasts at least 200ms
+#define REASSEMBLY_SEGMENTS 8      // Segments per message, below the default datagram queue length
+#define CYCLE_SIZE (64 * 1024)     // Message size of the send/receive cycle benchmark
+#define SMALL_SIZE 64              // Message size of the one-segment round trip
+#define COMPRESS_SIZE (1024 * 1024) // Payload size of the compression report
+#define GOODPUT_SIZE (256 * 1024)   // Message size of the goodput measurements
+
+/*
+ * Allocation counting: the benchmark is linked with --wrap for malloc,
+ * calloc and realloc (see the Makefile), so the calls of the library and of
+ * this file land here before going to the real allocator.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief Runs one benchmark body in batches and prints ns/op and allocs/op.
+ * The clock is only read around a batch, which doubles until it lasts
+ * MIN_BENCH_NS, and the last batch is the one reported.
+ * @param name Name of the benchmark.
+ * @param body Function running a single operation.
+ * @param arg Argument passed to the body.
+ */
+static void run(const char *name, void (*body)(void *), void *arg) {
+    body(arg);  // Warm up
+    unsigned long ops = 1;
+    unsigned long allocs;
+    uint64_t elapsed;
+    for (;;) {
+        allocs = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+        uint64_t start = now_ns();
+        for (unsigned long i = 0; i < ops; i++) {
+            body(arg);
+        }
+        elapsed = now_ns() - start;
+        allocs = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocs;
+        if (elapsed >= MIN_BENCH_NS) {
+            break;
+        }
+        ops *= 2;
+    }
+    printf("%-28s %12.1f %12.2f %12lu\n", name, (double)elapsed / ops, (double)allocs / ops, ops);
+}
+
+/**
+ * @brief Opens a connected pair of datagram sockets with fresh RUDP state.
+ * @param fds Array to store the two file descriptors.
+ * @return 0 on success, or -1 on failure.
+ */
+static int open_pair(int fds[2]) {
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == -1) {
+        return -1;
+    }
+    // The descriptor numbers are reused from earlier pairs, which may have left message state behind
+    rudp_reset_socket(fds[0]);
+    rudp_reset_socket(fds[1]);
+    return 0;
+}
+
+/**
+ * @brief Fills a buffer with log lines in JSON, the compressible kind of payload.
+ * @param buffer Pointer to the buffer to fill.
+ * @param size Size of the buffer.
+ */
+static void fill_json(char *buffer, int size) {
+    int pos = 0;
+    for (int i = 0; pos < size; i++) {
+        char line[160];
+        int len = snprintf(line, sizeof(line),
+                           "{\"ts\":%d,\"level\":\"%s\",\"module\":\"rudp\",\"seq\":%d,\"msg\":\"segment acked\"}\n",
+                           1700000000 + i, i % 7 ? "info" : "warn", i * 4000);
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        memcpy(buffer + pos, line, len);
+        pos += len;
+    }
+}
+
+static void fill_random(char *buffer, int size) {
+    srand(1);
+    for (int i = 0; i < size; i++) {
+        buffer[i] = (char)(rand() % 256);
+    }
+}
+
+/* Packet serialization and checksum */
+
+typedef struct SegmentArgs {
+    RUDP_Packet *packet;
+    const char *data;
+    int size;
+    int compress;
+} SegmentArgs;
+
+static volatile int sink;
+
+static void bench_checksum(void *arg) {
+    SegmentArgs *a = arg;
+    sink = calculate_checksum(a->packet);
+}
+
+static void bench_serialize(void *arg) {
+    SegmentArgs *a = arg;
+    sink = rudp_build_segment(a->packet, 0, a->data, a->size, a->compress);
+}
+
+/* Ack generation and processing over a socketpair */
+
+static void bench_ack(void *arg) {
+    int *fds = arg;
+    RUDP_Packet packet;
+    memset(&packet, 0, RUDP_HEADER_SIZE);
+    packet.sequalNum = 7;
+    sending_ack(fds[0], &packet);
+    sink = waiting_ack(fds[1], 7, clock(), 1);
+}
+
+/* Reassembly: a queued multi-segment message taken apart by rudp_receive */
+
+typedef struct ReassemblyArgs {
+    int fds[2];
+    RUDP_Packet *segments;
+    char *message;
+    int bit;
+} ReassemblyArgs;
+
+static void bench_reassembly(void *arg) {
+    ReassemblyArgs *a = arg;
+    RUDP_Packet ack;
+    for (int i = 0; i < REASSEMBLY_SEGMENTS; i++) {
+        RUDP_Packet *segment = &a->segments[i];
+        segment->flags.msgBit = a->bit;  // A new message each time, as rudp_send would mark it
+        send(a->fds[0], segment, RUDP_HEADER_SIZE + segment->length, 0);
+    }
+    a->bit = !a->bit;
+    int pos = 0;
+    int flag;
+    do {
+        char *buffer = NULL;
+        int size = 0;
+        flag = rudp_receive(a->fds[1], &buffer, &size);
+        if ((flag == 1 || flag == 5) && size > 0) {
+            memcpy(a->message + pos, buffer, size);
+            pos += size;
+            free(buffer);
+        }
+    } while (flag == 1);
+    // Throw away the acks rudp_receive sent back
+    while (recv(a->fds[0], &ack, sizeof(ack), MSG_DONTWAIT) > 0) {
+    }
+}
+
+/* Full send/receive cycle with a receiving thread */
+
+typedef struct CycleArgs {
+    int fds[2];
+    const char *data;
+    int size;
+    int stop;
+} CycleArgs;
+
+static void *receiver_main(void *arg) {
+    CycleArgs *a = arg;
+    for (;;) {
+        char *buffer = NULL;
+        int size = 0;
+        int flag = rudp_receive(a->fds[1], &buffer, &size);
+        if (flag == 1 || flag == 5) {
+            free(buffer);
+        } else if (flag < 0 || __atomic_load_n(&a->stop, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+    }
+}
+
+static void bench_cycle(void *arg) {
+    CycleArgs *a = arg;
+    rudp_send(a->fds[0], a->data, a->size);
+}
+
+static void run_cycle(const char *name, const char *data, int size, int spin_us) {
+    CycleArgs args;
+    if (open_pair(args.fds) == -1) {
+        perror("socketpair");
+        return;
+    }
+    struct timeval ack_timeout = {1, 0};
+    setsockopt(args.fds[0], SOL_SOCKET, SO_RCVTIMEO, &ack_timeout, sizeof(ack_timeout));
+    rudp_set_low_latency(args.fds[0], spin_us, -1);
+    rudp_set_low_latency(args.fds[1], spin_us, -1);
+    args.data = data;
+    args.size = size;
+    args.stop = 0;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, receiver_main, &args);
+    rudp_reset_poll_stats();
+    run(name, bench_cycle, &args);
+    if (spin_us > 0) {
+        RUDP_PollStats stats;
+        rudp_get_poll_stats(&stats);
+        printf("%-28s spin=%.1fms sleep=%.1fms spin_hits=%lu sleep_hits=%lu\n", "",
+               stats.spin_ns / 1e6, stats.sleep_ns / 1e6,
+               (unsigned long)stats.spin_hits, (unsigned long)stats.sleep_hits);
+    }
+
+    // Wake the receiving thread with a skip marker it acks and ignores, so it
+    // returns without either end writing to a closed peer
+    RUDP_Packet wake;
+    memset(&wake, 0, RUDP_HEADER_SIZE);
+    wake.flags.isSkip = 1;
+    wake.sequalNum = -1;
+    wake.checksum = calculate_checksum(&wake);
+    __atomic_store_n(&args.stop, 1, __ATOMIC_RELEASE);
+    send(args.fds[0], &wake, RUDP_HEADER_SIZE, 0);
+    pthread_join(thread, NULL);
+    close(args.fds[0]);
+    close(args.fds[1]);
+}
+
+/* Compression: cost of the stage, and goodput over emulated links */
+
+typedef struct GoodputArgs {
+    int fd;
+    const char *expected;
+    int size;
+    int ok;
+} GoodputArgs;
+
+static void *goodput_receiver(void *arg) {
+    GoodputArgs *a = arg;
+    char *message = malloc(a->size);
+    int pos = 0;
+    int flag;
+    do {
+        char *buffer = NULL;
+        int size = 0;
+        flag = rudp_receive(a->fd, &buffer, &size);
+        if ((flag == 1 || flag == 5) && size > 0) {
+            if (pos + size <= a->size) {
+                memcpy(message + pos, buffer, size);
+            }
+            pos += size;
+        }
+        free(buffer);
+    } while (flag != 5 && flag >= 0);
+    a->ok = flag == 5 && pos == a->size && memcmp(message, a->expected, a->size) == 0;
+    free(message);
+    return NULL;
+}
+
+/**
+ * @brief Sends one message through rudp_send over a socketpair paced to a link rate.
+ * @param data Pointer to the message.
+ * @param size Size of the message.
+ * @param kbit_per_s Emulated link rate.
+ * @param compress Whether the compression stage is on.
+ * @param ok Pointer to the variable to store whether the message arrived intact.
+ * @return Measured goodput in Mbit/s, or -1 on failure.
+ */
+static double measure_goodput(const char *data, int size, int kbit_per_s, int compress, int *ok) {
+    int fds[2];
+    if (open_pair(fds) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+    struct timeval ack_timeout = {1, 0};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &ack_timeout, sizeof(ack_timeout));
+    rudp_set_link_rate(fds[0], kbit_per_s);
+    rudp_set_compression(fds[0], compress);
+
+    GoodputArgs args = {fds[1], data, size, 0};
+    pthread_t thread;
+    uint64_t start = now_ns();
+    pthread_create(&thread, NULL, goodput_receiver, &args);
+    int sent = rudp_send(fds[0], data, size);
+    pthread_join(thread, NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    close(fds[0]);
+    close(fds[1]);
+    *ok = sent == 1 && args.ok;
+    return size * 8.0 / elapsed * 1000;
+}
+
+/**
+ * @brief Reports the compression stage on a payload: ratio and cost per byte of
+ * a verified round trip through the codec, then the goodput measured through
+ * rudp_send/rudp_receive on links of a few rates with the stage off and on.
+ * @param name Name of the payload.
+ * @param data Pointer to the payload.
+ * @param size Size of the payload.
+ */
+static void report_compression(const char *name, const char *data, int size) {
+    RUDP_Packet *packet = malloc(sizeof(RUDP_Packet));
+    char *out = malloc(RUDP_MAX_SPAN);
+    uint64_t wire = 0;
+    uint64_t decompress_ns = 0;
+    int intact = 1;
+    int bypass = rudp_sample_entropy(data, size) > RUDP_ENTROPY_BYPASS;
+
+    uint64_t start = now_ns();
+    for (int offset = 0, seq = 0; offset < size; seq++) {
+        int consumed = rudp_build_segment(packet, seq, data + offset, size - offset, !bypass);
+        wire += packet->length;
+        if (packet->flags.isCompressed) {
+            uint64_t begin = now_ns();
+            int got = rudp_lz_decompress(packet->data + sizeof(uint32_t), packet->length - sizeof(uint32_t),
+                                         out, RUDP_MAX_SPAN);
+            decompress_ns += now_ns() - begin;
+            intact = intact && got == consumed && memcmp(out, data + offset, consumed) == 0;
+        }
+        offset += consumed;
+    }
+    uint64_t compress_ns = now_ns() - start - decompress_ns;
+
+    printf("%-10s ratio=%.2f%s compress=%.2fns/B decompress=%.2fns/B round trip %s\n", name,
+           (double)size / wire, bypass ? " (bypassed)" : "",
+           (double)compress_ns / size, (double)decompress_ns / size, intact ? "ok" : "CORRUPT");
+
+    const int kbit_per_s[] = {10000, 100000, 1000000};
+    for (int i = 0; i < 3; i++) {
+        int raw_ok;
+        int compressed_ok;
+        double raw = measure_goodput(data, GOODPUT_SIZE, kbit_per_s[i], 0, &raw_ok);
+        double compressed = measure_goodput(data, GOODPUT_SIZE, kbit_per_s[i], 1, &compressed_ok);
+        printf("%-10s %6d Mbit/s: goodput %8.2f -> %8.2f Mbit/s (x%.2f)%s\n", "", kbit_per_s[i] / 1000,
+               raw, compressed, compressed / raw, raw_ok && compressed_ok ? "" : " MISMATCH");
+    }
+    free(packet);
+    free(out);
+}
+
+/**
+ * @brief Main function running the microbenchmarks of the protocol core.
+ * @return 0 on successful execution, 1 on failure.
+ */
+int main(void) {
+    char *json = malloc(COMPRESS_SIZE);
+    char *random = malloc(COMPRESS_SIZE);
+    RUDP_Packet *packet = malloc(sizeof(RUDP_Packet));
+    if (json == NULL || random == NULL || packet == NULL) {
+        printf("failed to allocate the payloads\n");
+        return 1;
+    }
+    fill_json(json, COMPRESS_SIZE);
+    fill_random(random, COMPRESS_SIZE);
+
+    printf("%-28s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op", "ops");
+
+    SegmentArgs segment = {packet, random, MAX_PACK_SIZE, 0};
+    run("calculate_checksum", bench_checksum, &segment);
+    run("serialize_raw", bench_serialize, &segment);
+    SegmentArgs compressed = {packet, json, RUDP_MAX_SPAN, 1};
+    run("serialize_compressed", bench_serialize, &compressed);
+
+    int fds[2];
+    if (open_pair(fds) == -1) {
+        perror("socketpair");
+        return 1;
+    }
+    run("ack_send_and_process", bench_ack, fds);
+    close(fds[0]);
+    close(fds[1]);
+
+    ReassemblyArgs reassembly;
+    if (open_pair(reassembly.fds) == -1) {
+        perror("socketpair");
+        return 1;
+    }
+    reassembly.segments = malloc(REASSEMBLY_SEGMENTS * sizeof(RUDP_Packet));
+    reassembly.message = malloc(REASSEMBLY_SEGMENTS * MAX_PACK_SIZE);
+    reassembly.bit = 0;
+    int offset = 0;
+    for (int i = 0; i < REASSEMBLY_SEGMENTS; i++) {
+        offset += rudp_build_segment(&reassembly.segments[i], i, random + offset,
+                                     REASSEMBLY_SEGMENTS * MAX_PACK_SIZE - offset, 0);
+    }
+    run("reassembly_8_segments", bench_reassembly, &reassembly);
+    close(reassembly.fds[0]);
+    close(reassembly.fds[1]);
+    free(reassembly.segments);
+    free(reassembly.message);
+
+    run_cycle("send_receive_64k", random, CYCLE_SIZE, 0);
+    run_cycle("rtt_1_segment", random, SMALL_SIZE, 0);
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+        run_cycle("rtt_1_segment_busy_poll", random, SMALL_SIZE, 50);
+    } else {
+        printf("%-28s skipped, spinning needs a second CPU\n", "rtt_1_segment_busy_poll");
+    }
+
+    printf("\n");
+    report_compression("json", json, COMPRESS_SIZE);
+    report_compression("random", random, COMPRESS_SIZE);
+
+    free(json);
+    free(random);
+    free(packet);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * Wasim
+ * Shifaa
+*/
+#include "RUDP_Compress.h"
+#include <math.h>       // For log2 in the entropy estimate
+#include <stdint.h>     // For fixed width integer types
+#include <string.h>     // For memcpy and memset
+
+#define LZ_MIN_MATCH 4          // Shortest match worth encoding
+#define LZ_MAX_OFFSET 65535     // Offsets are stored in two bytes
+#define LZ_HASH_BITS 12         // Size of the match finder table
+#define SAMPLE_RUN 64           // Bytes taken from each sampled position
+#define SAMPLE_RUNS 64          // Number of sampled positions
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int hash32(uint32_t v) {
+    return (int)((v * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+// Extra bytes needed by a length that does not fit in its 4 bit token nibble
+static int length_bytes(int n) {
+    return n >= 15 ? 1 + (n - 15) / 255 : 0;
+}
+
+static unsigned char *put_length(unsigned char *op, int n) {
+    for (n -= 15; n >= 255; n -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+/*
+ * Block format (LZ4-like): a sequence of tokens, each holding a literal run
+ * length in the high nibble and a match length in the low nibble, followed by
+ * the literals, a two byte little endian offset and the match. The last
+ * sequence may stop right after its literals.
+ */
+int rudp_lz_compress(const char *src, int src_len, char *dst, int dst_cap, int *consumed) {
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned char *oend = op + dst_cap;
+    int table[1 << LZ_HASH_BITS];  // Last position + 1 seen for each hash, 0 = empty
+    int anchor = 0;
+    int pos = 0;
+
+    memset(table, 0, sizeof(table));
+    while (pos + LZ_MIN_MATCH <= src_len) {
+        uint32_t seq = read32(in + pos);
+        int h = hash32(seq);
+        int cand = table[h] - 1;
+        table[h] = pos + 1;
+        if (cand < 0 || pos - cand > LZ_MAX_OFFSET || read32(in + cand) != seq) {
+            pos++;
+            continue;
+        }
+
+        int match_len = LZ_MIN_MATCH;
+        while (pos + match_len < src_len && in[cand + match_len] == in[pos + match_len]) {
+            match_len++;
+        }
+        int lit = pos - anchor;
+        int m = match_len - LZ_MIN_MATCH;
+        if (1 + length_bytes(lit) + lit + 2 + length_bytes(m) > oend - op) {
+            break;  // Output full, the rest goes out as literals below
+        }
+
+        *op++ = (unsigned char)(((lit < 15 ? lit : 15) << 4) | (m < 15 ? m : 15));
+        if (lit >= 15) {
+            op = put_length(op, lit);
+        }
+        memcpy(op, in + anchor, lit);
+        op += lit;
+        *op++ = (unsigned char)((pos - cand) & 0xff);
+        *op++ = (unsigned char)((pos - cand) >> 8);
+        if (m >= 15) {
+            op = put_length(op, m);
+        }
+        pos += match_len;
+        anchor = pos;
+    }
+
+    // Trailing literals, as many as still fit
+    int lit = src_len - anchor;
+    int room = (int)(oend - op);
+    if (lit > room - 1) {
+        lit = room - 1;
+    }
+    while (lit > 0 && 1 + length_bytes(lit) + lit > room) {
+        lit--;
+    }
+    if (lit > 0) {
+        *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4);
+        if (lit >= 15) {
+            op = put_length(op, lit);
+        }
+        memcpy(op, in + anchor, lit);
+        op += lit;
+        anchor += lit;
+    }
+
+    *consumed = anchor;
+    return (int)(op - (unsigned char *)dst);
+}
+
+int rudp_lz_decompress(const char *src, int src_len, char *dst, int dst_cap) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + src_len;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    unsigned char *oend = out + dst_cap;
+
+    while (ip < iend) {
+        int token = *ip++;
+        int b;
+
+        int lit = token >> 4;
+        if (lit == 15) {
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > iend - ip || lit > oend - op) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) {
+            break;  // Last sequence without a match
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - out) {
+            return -1;
+        }
+        int match_len = token & 15;
+        if (match_len == 15) {
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > oend - op) {
+            return -1;
+        }
+        // Byte by byte, the match may overlap the bytes it produces
+        const unsigned char *match = op - offset;
+        for (int i = 0; i < match_len; i++) {
+            op[i] = match[i];
+        }
+        op += match_len;
+    }
+    return (int)(op - out);
+}
+
+double rudp_sample_entropy(const char *data, int len) {
+    const unsigned char *in = (const unsigned char *)data;
+    unsigned int counts[256] = {0};
+    int total = 0;
+
+    if (len <= 0) {
+        return 0;
+    }
+    // Short data is read whole, longer data in runs spread across it
+    int stride = len / SAMPLE_RUNS;
+    if (stride < SAMPLE_RUN) {
+        stride = SAMPLE_RUN;
+    }
+    for (int start = 0; start < len; start += stride) {
+        int end = start + SAMPLE_RUN < len ? start + SAMPLE_RUN : len;
+        for (int i = start; i < end; i++) {
+            counts[in[i]]++;
+        }
+        total += end - start;
+    }
+
+    double entropy = 0;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            double p = (double)counts[i] / total;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
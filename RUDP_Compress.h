@@ -0,0 +1,39 @@
+/**
+ * @file RUDP_Compress.h
+ * @brief Header file for the compression stage of the RUDP API.
+ */
+
+#ifndef RUDP_COMPRESS_H
+#define RUDP_COMPRESS_H
+
+/**
+ * @brief Compresses data with the built-in LZ codec until the output is full.
+ * The output is a self-contained block, so it can be decompressed on its own.
+ * @param src Pointer to the data to be compressed.
+ * @param src_len Size of the data to be compressed.
+ * @param dst Pointer to the buffer to store the compressed block.
+ * @param dst_cap Capacity of the output buffer.
+ * @param consumed Pointer to the variable to store how many input bytes the block covers.
+ * @return Size of the compressed block.
+ */
+int rudp_lz_compress(const char *src, int src_len, char *dst, int dst_cap, int *consumed);
+
+/**
+ * @brief Decompresses a block produced by rudp_lz_compress.
+ * @param src Pointer to the compressed block.
+ * @param src_len Size of the compressed block.
+ * @param dst Pointer to the buffer to store the decompressed data.
+ * @param dst_cap Capacity of the output buffer.
+ * @return Size of the decompressed data, or -1 if the block is corrupt.
+ */
+int rudp_lz_decompress(const char *src, int src_len, char *dst, int dst_cap);
+
+/**
+ * @brief Estimates the entropy of the data from an evenly spread sample.
+ * @param data Pointer to the data to be sampled.
+ * @param len Size of the data.
+ * @return Estimated entropy in bits per byte (0 to 8).
+ */
+double rudp_sample_entropy(const char *data, int len);
+
+#endif
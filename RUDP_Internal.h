@@ -0,0 +1,44 @@
+/**
+ * @file RUDP_Internal.h
+ * @brief Header file for the internals of the RUDP API shared by its modules
+ * and the benchmarks, not part of the user-facing API.
+ */
+
+#ifndef RUDP_INTERNAL_H
+#define RUDP_INTERNAL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "RUDP_API.h"
+
+/**
+ * @brief Reads the monotonic clock.
+ * @return Current time in nanoseconds.
+ */
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Serializes the next data segment of a message into a packet, and
+ * counts it in the compression statistics when the stage is tried.
+ * @param rudp Pointer to the packet to fill.
+ * @param seq Sequence number of the segment.
+ * @param data Pointer to the part of the message not sent yet.
+ * @param remaining Size of the part of the message not sent yet.
+ * @param compress 1 to try the compression stage, 0 to copy the data raw.
+ * @return Number of message bytes the segment covers.
+ */
+int rudp_build_segment(RUDP_Packet *rudp, int seq, const char *data, int remaining, int compress);
+
+/**
+ * @brief Puts the per-socket settings and message state of a descriptor back
+ * to their defaults, for sockets that were not made by rudp_socket.
+ * @param socket File descriptor of the socket.
+ */
+void rudp_reset_socket(int socket);
+
+#endif
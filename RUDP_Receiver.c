@@ -19,11 +19,18 @@
  * @return 0 on successful execution, -1 on failure.
  */
 int main(int argc, char *argv[]) {
-    // Check if the correct number of command-line arguments is provided
-    if (strcmp(argv[1], "-p") != 0 || argc != 3  ) {
+    // Check if the correct number of command-line arguments is provided,
+    // extra paths come in groups of: -path <local ip> <port>
+    if (argc < 3 || (argc - 3) % 3 != 0 || strcmp(argv[1], "-p") != 0) {
         printf("Invalid  input\n");
         return -1;
     }
+    for (int i = 3; i < argc; i += 3) {
+        if (strcmp(argv[i], "-path") != 0) {
+            printf("Invalid  input\n");
+            return -1;
+        }
+    }
 
     printf("Starting Receiver...\n");
 
@@ -37,6 +44,14 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    // Extra paths have to listen before the sender connects and joins them
+    for (int i = 3; i < argc; i += 3) {
+        if (rudp_listen_path(sockfd, argv[i + 1], atoi(argv[i + 2])) == -1) {
+            printf("Failed to listen on path %s:%s\n", argv[i + 1], argv[i + 2]);
+            return -1;
+        }
+    }
+
     printf("Waiting for RUDP connection...\n");
 
     if (rudp_accept(sockfd, port) == 0) {
@@ -131,5 +146,8 @@ printf("- Average bandwidth: %.2f MB/s\n", average_bandwidth_MBps / (run - 1));
     // Close the file
     fclose(fp);
 
+    // Let the background TIME_WAIT answer a retransmitted FIN before exiting
+    rudp_drain(1000);
+
     return 0;
 }
@@ -44,10 +44,17 @@ int main(int argc, char *argv[]) {
     char *ip;
     int port_number;
 
-    if (argc != 5 || strcmp(argv[1], "-ip") != 0 || strcmp(argv[3], "-p") != 0) {
+    // Extra paths come in groups of: -path <local ip> <remote ip> <port> <loss %> <delay ms>
+    if (argc < 5 || (argc - 5) % 6 != 0 || strcmp(argv[1], "-ip") != 0 || strcmp(argv[3], "-p") != 0) {
         printf("invalid  input\n");
         return 1;
     }
+    for (int i = 5; i < argc; i += 6) {
+        if (strcmp(argv[i], "-path") != 0) {
+            printf("invalid  input\n");
+            return 1;
+        }
+    }
     ip = argv[2];
     char *port = argv[4];
     char *ptr;
@@ -75,6 +82,18 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Open the extra paths, each with its own emulated impairment
+    int paths = 1 + (argc - 5) / 6;
+    for (int i = 5; i < argc; i += 6) {
+        int path = rudp_add_path(socket, argv[i + 1], argv[i + 2], atoi(argv[i + 3]));
+        if (path == -1 || rudp_set_path_impairment(socket, path, atoi(argv[i + 4]), atoi(argv[i + 5])) == -1) {
+            fprintf(stderr, "Error: Failed to add RUDP path.\n");
+            rudp_close(socket);
+            free(data);
+            return 1;
+        }
+    }
+
     char option;
     do {
         printf("start Sending the data...\n");
@@ -84,6 +103,13 @@ int main(int argc, char *argv[]) {
             free(data);
             return 1;
         }
+        for (int i = 0; paths > 1 && i < paths; i++) {
+            RUDP_PathStats stats;
+            rudp_get_path_stats(socket, i, &stats);
+            printf("Path %d: srtt=%.2fms cwnd=%d sent=%lu retransmits=%lu%s\n", i, stats.srtt_us / 1000.0,
+                   stats.cwnd, (unsigned long)stats.sent, (unsigned long)stats.retransmits,
+                   stats.alive ? "" : " (down)");
+        }
         printf("Do you want to send it again? (y/n): \n");
         scanf(" %c", &option);
     } while (option == 'y');
@@ -94,5 +120,8 @@ int main(int argc, char *argv[]) {
     printf("Connection is closed\n");
     free(data);
 
+    // Let the background close finish its FIN exchange before exiting
+    rudp_drain(1000);
+
     return 0;
 }
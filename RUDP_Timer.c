@@ -0,0 +1,189 @@
+/**
+ * Wasim
+ * Shifaa
+*/
+#include "RUDP_Timer.h"
+#include "RUDP_API.h"
+#include "RUDP_Internal.h"
+#include <errno.h>      // For error handling
+#include <poll.h>       // For waiting on the closing sockets
+#include <pthread.h>    // For the background timer thread
+#include <sys/socket.h> // For socket related functions
+#include <time.h>       // For time related functions
+#include <unistd.h>     // For close
+
+#define RUDP_MAX_CLOSING 64     // Sockets that can be closing at the same time
+#define RUDP_TIMER_TICK_MS 10   // Longest the thread sleeps before picking up new sockets
+
+enum { CLOSE_FREE = 0 };
+
+typedef struct Closing {
+    int fd;
+    int state;          // CLOSE_FREE, RUDP_CLOSE_FIN_WAIT or RUDP_CLOSE_TIME_WAIT
+    int retries;
+    uint64_t deadline;  // Next FIN retransmission, or the end of TIME_WAIT
+} Closing;
+
+static Closing closings[RUDP_MAX_CLOSING];
+static int closing_count = 0;
+static int timer_running = 0;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_idle = PTHREAD_COND_INITIALIZER;
+
+// Sends a FIN (sequence number -1), or the FIN-ACK answering one
+static void send_fin(int fd, int ack) {
+    RUDP_Packet fin;
+    memset(&fin, 0, RUDP_HEADER_SIZE);
+    fin.flags.fin = 1;
+    fin.flags.ack = ack;
+    fin.sequalNum = -1;
+    fin.checksum = calculate_checksum(&fin);
+    send(fd, &fin, RUDP_HEADER_SIZE, MSG_DONTWAIT);
+}
+
+// Called with timer_lock held
+static void finish(Closing *c) {
+    close(c->fd);
+    c->state = CLOSE_FREE;
+    if (--closing_count == 0) {
+        pthread_cond_broadcast(&timer_idle);
+    }
+}
+
+// Called with timer_lock held, reads everything queued on the socket
+static void on_readable(Closing *c, uint64_t now) {
+    RUDP_Packet packet;
+    for (;;) {
+        ssize_t got = recv(c->fd, &packet, sizeof(packet), MSG_DONTWAIT);
+        if (got == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && c->state == RUDP_CLOSE_FIN_WAIT) {
+                finish(c);  // The peer is gone, nobody is left to answer the FIN
+            }
+            return;
+        }
+        if (got < (ssize_t)RUDP_HEADER_SIZE || packet.sequalNum != -1) {
+            continue;  // Late data or acks of the connection
+        }
+        if (c->state == RUDP_CLOSE_FIN_WAIT && packet.flags.ack) {
+            finish(c);
+            return;
+        }
+        if (c->state == RUDP_CLOSE_TIME_WAIT && packet.flags.fin && !packet.flags.ack) {
+            // Our FIN-ACK got lost, answer again and restart the quiet time
+            send_fin(c->fd, 1);
+            c->deadline = now + RUDP_TIME_WAIT_MS * 1000000ULL;
+        }
+    }
+}
+
+// Called with timer_lock held
+static void on_deadline(Closing *c, uint64_t now) {
+    if (c->state == RUDP_CLOSE_FIN_WAIT && c->retries < RUDP_FIN_RETRIES) {
+        c->retries++;
+        send_fin(c->fd, 0);
+        c->deadline = now + ((uint64_t)RUDP_FIN_RTO_MS << c->retries) * 1000000ULL;
+        return;
+    }
+    finish(c);
+}
+
+static void *timer_main(void *arg) {
+    (void)arg;
+    struct pollfd fds[RUDP_MAX_CLOSING];
+    int index[RUDP_MAX_CLOSING];
+
+    pthread_mutex_lock(&timer_lock);
+    while (closing_count > 0) {
+        // Wait on every closing socket until the nearest deadline
+        uint64_t now = now_ns();
+        uint64_t next = now + RUDP_TIMER_TICK_MS * 1000000ULL;
+        int n = 0;
+        for (int i = 0; i < RUDP_MAX_CLOSING; i++) {
+            if (closings[i].state == CLOSE_FREE) {
+                continue;
+            }
+            fds[n].fd = closings[i].fd;
+            fds[n].events = POLLIN;
+            fds[n].revents = 0;
+            index[n++] = i;
+            if (closings[i].deadline < next) {
+                next = closings[i].deadline;
+            }
+        }
+        pthread_mutex_unlock(&timer_lock);
+        poll(fds, n, next > now ? (int)((next - now + 999999) / 1000000) : 0);
+        pthread_mutex_lock(&timer_lock);
+
+        now = now_ns();
+        for (int k = 0; k < n; k++) {
+            if (fds[k].revents != 0 && closings[index[k]].state != CLOSE_FREE) {
+                on_readable(&closings[index[k]], now);
+            }
+        }
+        for (int i = 0; i < RUDP_MAX_CLOSING; i++) {
+            if (closings[i].state != CLOSE_FREE && now >= closings[i].deadline) {
+                on_deadline(&closings[i], now);
+            }
+        }
+    }
+    timer_running = 0;
+    pthread_mutex_unlock(&timer_lock);
+    return NULL;
+}
+
+int rudp_timer_add_close(int fd, int state) {
+    pthread_mutex_lock(&timer_lock);
+    Closing *c = NULL;
+    for (int i = 0; i < RUDP_MAX_CLOSING && c == NULL; i++) {
+        if (closings[i].state == CLOSE_FREE) {
+            c = &closings[i];
+        }
+    }
+    if (c == NULL) {
+        pthread_mutex_unlock(&timer_lock);
+        fprintf(stderr, "Too many closing sockets, closing right away\n");
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->state = state;
+    c->retries = 0;
+    c->deadline = now_ns() + (state == RUDP_CLOSE_FIN_WAIT ? RUDP_FIN_RTO_MS : RUDP_TIME_WAIT_MS) * 1000000ULL;
+    closing_count++;
+
+    // The thread runs while sockets are closing and exits when the last one is done
+    if (!timer_running) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, timer_main, NULL) != 0) {
+            perror("Failed to start the timer thread");
+            finish(c);
+            pthread_mutex_unlock(&timer_lock);
+            return -1;
+        }
+        pthread_detach(thread);
+        timer_running = 1;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return 0;
+}
+
+int rudp_timer_drain(int timeout_ms) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += timeout_ms / 1000;
+    until.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&timer_lock);
+    while (closing_count > 0) {
+        if (pthread_cond_timedwait(&timer_idle, &timer_lock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    int left = closing_count;
+    pthread_mutex_unlock(&timer_lock);
+    return left;
+}
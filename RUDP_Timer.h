@@ -0,0 +1,33 @@
+/**
+ * @file RUDP_Timer.h
+ * @brief Header file for the timer subsystem of the RUDP API.
+ */
+
+#ifndef RUDP_TIMER_H
+#define RUDP_TIMER_H
+
+#define RUDP_CLOSE_FIN_WAIT 1   /**< FIN sent, retransmitting it until the FIN-ACK arrives. */
+#define RUDP_CLOSE_TIME_WAIT 2  /**< FIN-ACK sent, answering retransmitted FINs for a while. */
+
+#define RUDP_FIN_RTO_MS 100     /**< First FIN retransmission timeout, doubled on every retry. */
+#define RUDP_FIN_RETRIES 5      /**< FIN retransmissions before giving up on the FIN-ACK. */
+#define RUDP_TIME_WAIT_MS 200   /**< Quiet time the receiving side lingers before closing. */
+
+/**
+ * @brief Hands a closing socket to the background timer thread.
+ * The thread runs the rest of the close state machine and closes the socket,
+ * so the caller must not use it afterwards.
+ * @param fd File descriptor of the closing socket.
+ * @param state RUDP_CLOSE_FIN_WAIT or RUDP_CLOSE_TIME_WAIT.
+ * @return 0 on success, or -1 if the socket had to be closed right away.
+ */
+int rudp_timer_add_close(int fd, int state);
+
+/**
+ * @brief Waits for the sockets handed to the timer thread to be closed.
+ * @param timeout_ms Longest time to wait in milliseconds.
+ * @return Number of sockets still closing when the wait ended.
+ */
+int rudp_timer_drain(int timeout_ms);
+
+#endif